@@ -274,9 +274,10 @@ static void load(gint nparams, const GimpParam* param, gint* nreturn_vals, GimpP
 
 typedef struct {
   gint super_compression;
+  gint texture_set;
 } SaveOptions;
 
-static const SaveOptions DEFAULT_SAVE_OPTIONS = {0};
+static const SaveOptions DEFAULT_SAVE_OPTIONS = {0, 0};
 static gboolean show_options(SaveOptions* save_options) {
 
   GtkWidget* dialog = gimp_export_dialog_new("KTX2", PLUG_IN_BINARY, NULL);
@@ -314,212 +315,551 @@ static gboolean show_options(SaveOptions* save_options) {
       "Super Compression: 0 Uncompressed",
       "?");
 
+  GtkWidget* texture_set_toggle = gtk_check_button_new_with_label("Export visible layers as texture set");
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(texture_set_toggle), save_options->texture_set);
+  gtk_widget_set_tooltip_text(texture_set_toggle,
+      "Write every visible layer to its own <name>_<layer>.ktx2 file instead of <name>.ktx2 itself. "
+      "You are asked once before existing files with these names are overwritten.");
+  gtk_box_pack_start(GTK_BOX(vbox), texture_set_toggle, FALSE, FALSE, 0);
+  gtk_widget_show(texture_set_toggle);
+
   gtk_widget_show(dialog);
 
   gboolean dialog_result = gimp_dialog_run(GIMP_DIALOG(dialog)) == GTK_RESPONSE_OK;
 
   save_options->super_compression = (gint)gtk_adjustment_get_value(GTK_ADJUSTMENT(super_compression_combo_box));
+  save_options->texture_set = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(texture_set_toggle));
 
   gtk_widget_destroy(dialog);
 
   return dialog_result;
 }
 
-typedef struct {
-  gint32 drawable_ID;
-  GeglBuffer* drawable;
-  ktxTexture2* texture;
-  const Babl* format;
-} mip_map_userdata_t;
-
-KTX_error_code mipmap_export(
-    int miplevel, int face, int width, int height, int depth, ktx_uint64_t faceLodSize, void* pixels, void* userdata) {
-  mip_map_userdata_t* ud = (mip_map_userdata_t*)userdata;
-  GeglRectangle rect = {.x = 0, .y = 0, .width = width, .height = height};
-  GeglBuffer* mbuf = gegl_buffer_new(&rect, gimp_drawable_get_format(ud->drawable_ID));
-  gegl_render_op(ud->drawable,
-      mbuf,
-      "gegl:scale-size",
-      "x",
-      (double)width,
-      "y",
-      (double)height,
-      "sampler",
-      GEGL_SAMPLER_CUBIC, // TODFO: Setting
-      NULL);
-  gegl_buffer_get(mbuf, NULL, 1, ud->format, pixels, ktxTexture_GetRowPitch(ktxTexture(ud->texture), miplevel), GEGL_ABYSS_NONE);
-  g_object_unref(mbuf);
-  return KTX_SUCCESS;
-}
-
-static void save(gint nparams, const GimpParam* param, gint* nreturn_vals, GimpParam** return_vals) {
-  GimpParam* ret_values = g_new(GimpParam, 2);
-  *nreturn_vals = 2;
-  *return_vals = ret_values;
-  {
-    ret_values[0].type = GIMP_PDB_STATUS;
-    ret_values[0].data.d_status = GIMP_PDB_EXECUTION_ERROR;
-    ret_values[1].type = GIMP_PDB_STRING;
-    ret_values[1].data.d_string = "Error while saveing";
-  }
-  GimpRunMode run_mode = (GimpRunMode)param[0].data.d_int32;
-  gint32 image_ID = param[1].data.d_int32;
-  gint32 drawable_ID = param[2].data.d_int32;
-  gchar* filename = param[3].data.d_string;
-  gimp_ui_init(PLUG_IN_BINARY, FALSE);
-
-  GimpExportCapabilities capabilities = GIMP_EXPORT_CAN_HANDLE_RGB | GIMP_EXPORT_CAN_HANDLE_GRAY | GIMP_EXPORT_CAN_HANDLE_ALPHA;
-  GimpExportReturn export_return = gimp_export_image(&image_ID, &drawable_ID, "KTX2", capabilities);
-  if (export_return == GIMP_EXPORT_CANCEL) {
-    ret_values[0].data.d_status = GIMP_PDB_CANCEL;
-    return;
-  }
-  GimpImageType image_type = gimp_drawable_type(drawable_ID);
-  GimpPrecision precision = gimp_image_get_precision(image_ID);
-
-  ktxTextureCreateInfo create_info;
-  const Babl* format = gimp_drawable_get_format(drawable_ID);
+static const char* choose_vk_format(GimpImageType image_type, GimpPrecision precision, VkFormat* vk_format) {
   switch (image_type) {
   case GIMP_GRAY_IMAGE:
     switch ((unsigned)precision) {
     case GIMP_PRECISION_U8_LINEAR:
-      create_info.vkFormat = VK_FORMAT_R8_UNORM;
+      *vk_format = VK_FORMAT_R8_UNORM;
       break;
     case 150: // GIMP_PRECISION_U8_NON_LINEAR
     case 175: // GIMP_PRECISION_U8_PERCEPTUAL
-      create_info.vkFormat = VK_FORMAT_R8_SRGB;
+      *vk_format = VK_FORMAT_R8_SRGB;
       break;
     case GIMP_PRECISION_U16_LINEAR:
     case 250: // GIMP_PRECISION_U16_NON_LINEAR
     case 275: // GIMP_PRECISION_U16_PERCEPTUAL
-      create_info.vkFormat = VK_FORMAT_R16_UNORM;
+      *vk_format = VK_FORMAT_R16_UNORM;
       break;
     case GIMP_PRECISION_U32_LINEAR:
     case 350: // GIMP_PRECISION_U32_NON_LINEAR
     case 375: // GIMP_PRECISION_U32_PERCEPTUAL
-      create_info.vkFormat = VK_FORMAT_R32_UINT;
+      *vk_format = VK_FORMAT_R32_UINT;
       break;
     case GIMP_PRECISION_HALF_LINEAR:
     case 550: // GIMP_PRECISION_HALF_NON_LINEAR
     case 575: // GIMP_PRECISION_HALF_PERCEPTUAL
-      create_info.vkFormat = VK_FORMAT_R16_SFLOAT;
+      *vk_format = VK_FORMAT_R16_SFLOAT;
       break;
     case GIMP_PRECISION_FLOAT_LINEAR:
     case 650: // GIMP_PRECISION_FLOAT_NON_LINEAR
     case 675: // GIMP_PRECISION_FLOAT_PERCEPTUAL
-      create_info.vkFormat = VK_FORMAT_R32_SFLOAT;
+      *vk_format = VK_FORMAT_R32_SFLOAT;
       break;
     default:
-      ret_values[1].data.d_string = "Unhandled image precision";
-      return;
+      return "Unhandled image precision";
     }
     break;
   case GIMP_GRAYA_IMAGE:
     switch ((unsigned)precision) {
     case GIMP_PRECISION_U8_LINEAR:
-      create_info.vkFormat = VK_FORMAT_R8G8_UNORM;
+      *vk_format = VK_FORMAT_R8G8_UNORM;
       break;
     case 150: // GIMP_PRECISION_U8_NON_LINEAR
     case 175: // GIMP_PRECISION_U8_PERCEPTUAL
-      create_info.vkFormat = VK_FORMAT_R8G8_SRGB;
+      *vk_format = VK_FORMAT_R8G8_SRGB;
       break;
     case GIMP_PRECISION_U16_LINEAR:
     case 250: // GIMP_PRECISION_U16_NON_LINEAR
     case 275: // GIMP_PRECISION_U16_PERCEPTUAL
-      create_info.vkFormat = VK_FORMAT_R16G16_UNORM;
+      *vk_format = VK_FORMAT_R16G16_UNORM;
       break;
     case GIMP_PRECISION_U32_LINEAR:
     case 350: // GIMP_PRECISION_U32_NON_LINEAR
     case 375: // GIMP_PRECISION_U32_PERCEPTUAL
-      create_info.vkFormat = VK_FORMAT_R32G32_UINT;
+      *vk_format = VK_FORMAT_R32G32_UINT;
       break;
     case GIMP_PRECISION_HALF_LINEAR:
     case 550: // GIMP_PRECISION_HALF_NON_LINEAR
     case 575: // GIMP_PRECISION_HALF_PERCEPTUAL
-      create_info.vkFormat = VK_FORMAT_R16G16_SFLOAT;
+      *vk_format = VK_FORMAT_R16G16_SFLOAT;
       break;
     case GIMP_PRECISION_FLOAT_LINEAR:
     case 650: // GIMP_PRECISION_FLOAT_NON_LINEAR
     case 675: // GIMP_PRECISION_FLOAT_PERCEPTUAL
-      create_info.vkFormat = VK_FORMAT_R32G32_SFLOAT;
+      *vk_format = VK_FORMAT_R32G32_SFLOAT;
       break;
     default:
-      ret_values[1].data.d_string = "Unhandled image precision";
-      return;
+      return "Unhandled image precision";
     }
     break;
   case GIMP_RGB_IMAGE:
     switch ((unsigned)precision) {
     case GIMP_PRECISION_U8_LINEAR:
-      create_info.vkFormat = VK_FORMAT_R8G8B8_UNORM;
+      *vk_format = VK_FORMAT_R8G8B8_UNORM;
       break;
     case 150: // GIMP_PRECISION_U8_NON_LINEAR
     case 175: // GIMP_PRECISION_U8_PERCEPTUAL
-      create_info.vkFormat = VK_FORMAT_R8G8B8_SRGB;
+      *vk_format = VK_FORMAT_R8G8B8_SRGB;
       break;
     case GIMP_PRECISION_U16_LINEAR:
     case 250: // GIMP_PRECISION_U16_NON_LINEAR
     case 275: // GIMP_PRECISION_U16_PERCEPTUAL
-      create_info.vkFormat = VK_FORMAT_R16G16B16_UNORM;
+      *vk_format = VK_FORMAT_R16G16B16_UNORM;
       break;
     case GIMP_PRECISION_U32_LINEAR:
     case 350: // GIMP_PRECISION_U32_NON_LINEAR
     case 375: // GIMP_PRECISION_U32_PERCEPTUAL
-      create_info.vkFormat = VK_FORMAT_R32G32B32_UINT;
+      *vk_format = VK_FORMAT_R32G32B32_UINT;
       break;
     case GIMP_PRECISION_HALF_LINEAR:
     case 550: // GIMP_PRECISION_HALF_NON_LINEAR
     case 575: // GIMP_PRECISION_HALF_PERCEPTUAL
-      create_info.vkFormat = VK_FORMAT_R16G16B16_SFLOAT;
+      *vk_format = VK_FORMAT_R16G16B16_SFLOAT;
       break;
     case GIMP_PRECISION_FLOAT_LINEAR:
     case 650: // GIMP_PRECISION_FLOAT_NON_LINEAR
     case 675: // GIMP_PRECISION_FLOAT_PERCEPTUAL
-      create_info.vkFormat = VK_FORMAT_R32G32B32_SFLOAT;
+      *vk_format = VK_FORMAT_R32G32B32_SFLOAT;
       break;
     default:
-      ret_values[1].data.d_string = "Unhandled image precision";
-      return;
+      return "Unhandled image precision";
     }
     break;
   case GIMP_RGBA_IMAGE:
     switch ((unsigned)precision) {
     case GIMP_PRECISION_U8_LINEAR:
-      create_info.vkFormat = VK_FORMAT_R8G8B8A8_UNORM;
+      *vk_format = VK_FORMAT_R8G8B8A8_UNORM;
       break;
     case 150: // GIMP_PRECISION_U8_NON_LINEAR
     case 175: // GIMP_PRECISION_U8_PERCEPTUAL
-      create_info.vkFormat = VK_FORMAT_R8G8B8A8_SRGB;
+      *vk_format = VK_FORMAT_R8G8B8A8_SRGB;
       break;
     case GIMP_PRECISION_U16_LINEAR:
     case 250: // GIMP_PRECISION_U16_NON_LINEAR
     case 275: // GIMP_PRECISION_U16_PERCEPTUAL
-      create_info.vkFormat = VK_FORMAT_R16G16B16A16_UNORM;
+      *vk_format = VK_FORMAT_R16G16B16A16_UNORM;
       break;
     case GIMP_PRECISION_U32_LINEAR:
     case 350: // GIMP_PRECISION_U32_NON_LINEAR
     case 375: // GIMP_PRECISION_U32_PERCEPTUAL
-      create_info.vkFormat = VK_FORMAT_R32G32B32A32_UINT;
+      *vk_format = VK_FORMAT_R32G32B32A32_UINT;
       break;
     case GIMP_PRECISION_HALF_LINEAR:
     case 550: // GIMP_PRECISION_HALF_NON_LINEAR
     case 575: // GIMP_PRECISION_HALF_PERCEPTUAL
-      create_info.vkFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+      *vk_format = VK_FORMAT_R16G16B16A16_SFLOAT;
       break;
     case GIMP_PRECISION_FLOAT_LINEAR:
     case 650: // GIMP_PRECISION_FLOAT_NON_LINEAR
     case 675: // GIMP_PRECISION_FLOAT_PERCEPTUAL
-      create_info.vkFormat = VK_FORMAT_R32G32B32A32_SFLOAT;
+      *vk_format = VK_FORMAT_R32G32B32A32_SFLOAT;
       break;
     default:
-      ret_values[1].data.d_string = "Unhandled image precision";
-      return;
+      return "Unhandled image precision";
     }
     break;
   default:
-    ret_values[1].data.d_string = "Unhandled image format";
+    return "Unhandled image format";
+  }
+  return NULL;
+}
+
+typedef struct {
+  GeglBuffer* drawable;
+  ktxTexture2* texture;
+  const Babl* format;
+} mip_map_userdata_t;
+
+KTX_error_code mipmap_export(
+    int miplevel, int face, int width, int height, int depth, ktx_uint64_t faceLodSize, void* pixels, void* userdata) {
+  mip_map_userdata_t* ud = (mip_map_userdata_t*)userdata;
+  GeglRectangle rect = {.x = 0, .y = 0, .width = width, .height = height};
+  GeglBuffer* mbuf = gegl_buffer_new(&rect, gegl_buffer_get_format(ud->drawable));
+  gegl_render_op(ud->drawable,
+      mbuf,
+      "gegl:scale-size",
+      "x",
+      (double)width,
+      "y",
+      (double)height,
+      "sampler",
+      GEGL_SAMPLER_CUBIC, // TODFO: Setting
+      NULL);
+  gegl_buffer_get(mbuf, NULL, 1, ud->format, pixels, ktxTexture_GetRowPitch(ktxTexture(ud->texture), miplevel), GEGL_ABYSS_NONE);
+  g_object_unref(mbuf);
+  return KTX_SUCCESS;
+}
+
+typedef struct {
+  GeglBuffer* drawable;
+  const Babl* format;
+  VkFormat vk_format;
+  gint super_compression;
+  gchar* filename;
+  const char* error;
+} export_job_t;
+
+// libktx initializes basisu on the first CompressBasis call of the process behind an unlocked static flag,
+// so the first call runs alone and the texture set workers only compress concurrently after it
+static KTX_error_code compress_basis(ktxTexture2* texture, ktx_uint32_t quality) {
+  static GMutex first_use_mutex;
+  static gboolean first_use_done = FALSE;
+  g_mutex_lock(&first_use_mutex);
+  if (!first_use_done) {
+    KTX_error_code result = ktxTexture2_CompressBasis(texture, quality);
+    first_use_done = TRUE;
+    g_mutex_unlock(&first_use_mutex);
+    return result;
+  }
+  g_mutex_unlock(&first_use_mutex);
+  return ktxTexture2_CompressBasis(texture, quality);
+}
+
+// Only touches gegl and libktx, never the PDB. Buffers from gimp_drawable_get_buffer still read their tiles
+// over the plug-in wire though, so off the main thread job->drawable must be a local copy (see save_texture_set)
+static void export_texture(export_job_t* job) {
+  ktxTextureCreateInfo create_info = {0};
+  create_info.vkFormat = job->vk_format;
+  create_info.baseWidth = gegl_buffer_get_width(job->drawable);
+  create_info.baseHeight = gegl_buffer_get_height(job->drawable);
+  create_info.baseDepth = 1;
+  create_info.numDimensions = 2;
+  GLuint max_dim = create_info.baseWidth > create_info.baseHeight ? create_info.baseWidth : create_info.baseHeight;
+  create_info.numLevels = log2(max_dim) + 1;
+  // create_info.numLevels = 1; // TODO: Setting
+  create_info.numLayers = 1;
+  create_info.numFaces = 1;
+  create_info.isArray = KTX_FALSE;
+  create_info.generateMipmaps = KTX_FALSE;
+  ktxTexture2* texture;
+  KTX_error_code result = ktxTexture2_Create(&create_info, KTX_TEXTURE_CREATE_ALLOC_STORAGE, &texture);
+  if (result != KTX_SUCCESS) {
+    job->error = ktxErrorString(result);
     return;
   }
+  mip_map_userdata_t mip_map_userdata;
+  mip_map_userdata.drawable = job->drawable;
+  mip_map_userdata.texture = texture;
+  mip_map_userdata.format = job->format;
+  result = ktxTexture_IterateLevelFaces(ktxTexture(texture), &mipmap_export, &mip_map_userdata);
+  if ((result == KTX_SUCCESS) && job->super_compression)
+    result = compress_basis(texture, job->super_compression);
+  if (result == KTX_SUCCESS)
+    result = ktxTexture_WriteToNamedFile(ktxTexture(texture), job->filename);
+  if (result != KTX_SUCCESS)
+    job->error = ktxErrorString(result);
+  ktxTexture_Destroy(ktxTexture(texture));
+}
+
+static void export_texture_worker(gpointer data, gpointer user_data) {
+  export_texture((export_job_t*)data);
+}
+
+// Texture sets write every visible top level layer (or layer group) of the image to <filename>_<layer name>.ktx2,
+// each at the canvas size. Layer opacity and mode are not applied, a texture holds the layer pixels alone.
+// The layer name picks the channels and whether super compression is applied: either by keyword
+// ("Normal" is exported as RG without compression) or explicitly by tags like "Mask [r,raw]".
+// Data maps are never tagged as sRGB, so samplers do not decode normals or roughness as colors.
+typedef struct {
+  const char* keyword;
+  gint channels; // 0 keeps the channels of the layer
+  gboolean compress;
+  gboolean data;
+} TextureSetRule;
+
+static const TextureSetRule TEXTURE_SET_RULES[] = {
+    {"normal", 2, FALSE, TRUE},
+    {"normals", 2, FALSE, TRUE},
+    {"height", 1, FALSE, TRUE},
+    {"rough", 1, TRUE, TRUE},
+    {"roughness", 1, TRUE, TRUE},
+    {"metal", 1, TRUE, TRUE},
+    {"metallic", 1, TRUE, TRUE},
+    {"occlusion", 1, TRUE, TRUE},
+    {"ao", 1, TRUE, TRUE},
+};
+
+static const TextureSetRule DEFAULT_TEXTURE_SET_RULE = {NULL, 0, TRUE, FALSE};
+
+// Keywords only match whole words of the name in front of the tags, so "Aorta" or "Normalized" keep the default rule
+static gboolean has_word(const gchar* layer_name, const gchar* keyword) {
+  gchar* name = g_strndup(layer_name, strcspn(layer_name, "["));
+  g_strcanon(name, G_CSET_a_2_z G_CSET_A_2_Z G_CSET_DIGITS, ' ');
+  gchar** word_list = g_strsplit(name, " ", -1);
+  gboolean found = FALSE;
+  for (gchar** word = word_list; *word && !found; word++)
+    found = g_ascii_strcasecmp(*word, keyword) == 0;
+  g_strfreev(word_list);
+  g_free(name);
+  return found;
+}
+
+static TextureSetRule texture_set_rule(const gchar* layer_name) {
+  TextureSetRule rule = DEFAULT_TEXTURE_SET_RULE;
+  for (size_t rule_i = 0; rule_i < G_N_ELEMENTS(TEXTURE_SET_RULES); rule_i++) {
+    if (has_word(layer_name, TEXTURE_SET_RULES[rule_i].keyword)) {
+      rule = TEXTURE_SET_RULES[rule_i];
+      break;
+    }
+  }
+  const gchar* tags_start = strchr(layer_name, '[');
+  if (tags_start) {
+    gchar* tags = g_strndup(tags_start + 1, strcspn(tags_start + 1, "]"));
+    gchar** tag_list = g_strsplit_set(tags, ", ", -1);
+    for (gchar** tag = tag_list; *tag; tag++) {
+      if (g_ascii_strcasecmp(*tag, "r") == 0)
+        rule.channels = 1;
+      else if (g_ascii_strcasecmp(*tag, "rg") == 0)
+        rule.channels = 2;
+      else if (g_ascii_strcasecmp(*tag, "rgb") == 0)
+        rule.channels = 3;
+      else if (g_ascii_strcasecmp(*tag, "rgba") == 0)
+        rule.channels = 4;
+      else if (g_ascii_strcasecmp(*tag, "raw") == 0)
+        rule.compress = FALSE;
+      else if (g_ascii_strcasecmp(*tag, "basis") == 0)
+        rule.compress = TRUE;
+      else if (g_ascii_strcasecmp(*tag, "data") == 0)
+        rule.data = TRUE;
+      else if (g_ascii_strcasecmp(*tag, "srgb") == 0)
+        rule.data = FALSE;
+    }
+    g_strfreev(tag_list);
+    g_free(tags);
+  }
+  return rule;
+}
+
+// Different layer names can clean up to the same suffix ("Mask [r]" and "Mask [rg]"), so used_suffixes
+// (compared case insensitively, for case insensitive file systems) numbers the repeats: _Mask, _Mask_2, ...
+static gchar* texture_set_filename(const gchar* filename, const gchar* layer_name, gint layer_i, GHashTable* used_suffixes) {
+  gchar* suffix = g_strndup(layer_name, strcspn(layer_name, "["));
+  g_strstrip(suffix);
+  g_strcanon(suffix, G_CSET_a_2_z G_CSET_A_2_Z G_CSET_DIGITS "-_", '_');
+  if (!*suffix) {
+    g_free(suffix);
+    suffix = g_strdup_printf("layer%d", layer_i);
+  }
+  gchar* key = g_ascii_strdown(suffix, -1);
+  for (gint repeat = 2; g_hash_table_contains(used_suffixes, key); repeat++) {
+    gchar* numbered_suffix = g_strdup_printf("%s_%d", suffix, repeat);
+    g_free(key);
+    key = g_ascii_strdown(numbered_suffix, -1);
+    if (g_hash_table_contains(used_suffixes, key)) {
+      g_free(numbered_suffix);
+    } else {
+      g_free(suffix);
+      suffix = numbered_suffix;
+    }
+  }
+  g_hash_table_add(used_suffixes, key);
+  const gchar* basename = strrchr(filename, G_DIR_SEPARATOR);
+  basename = basename ? basename + 1 : filename;
+  const gchar* extension = strrchr(basename, '.');
+  if (!extension)
+    extension = basename + strlen(basename);
+  gchar* result = g_strdup_printf("%.*s_%s%s", (int)(extension - filename), filename, suffix, extension);
+  g_free(suffix);
+  return result;
+}
+
+// Format reading the first channels components of the drawable, e.g. R and G of a normal map.
+// It keeps the space of the drawable format, so images with a non sRGB profile are not color converted.
+static const Babl* texture_set_format(gint32 drawable_ID, gint channels, gboolean linear) {
+  const Babl* drawable_format = gimp_drawable_get_format(drawable_ID);
+  const Babl* type = babl_format_get_type(drawable_format, 0);
+  if (gimp_drawable_is_gray(drawable_ID) && (channels <= 2)) {
+    return babl_format_with_space(babl_format_new(babl_model(linear ? "YA" : "Y'A"),
+                                      type,
+                                      babl_component(linear ? "Y" : "Y'"),
+                                      channels > 1 ? babl_component("A") : NULL,
+                                      NULL),
+        drawable_format);
+  }
+  static const char* const linear_components[] = {"R", "G", "B", "A"};
+  static const char* const non_linear_components[] = {"R'", "G'", "B'", "A"};
+  const char* const* components = linear ? linear_components : non_linear_components;
+  return babl_format_with_space(babl_format_new(babl_model(linear ? "RGBA" : "R'G'B'A"),
+                                    type,
+                                    babl_component(components[0]),
+                                    channels > 1 ? babl_component(components[1]) : NULL,
+                                    channels > 2 ? babl_component(components[2]) : NULL,
+                                    channels > 3 ? babl_component(components[3]) : NULL,
+                                    NULL),
+      drawable_format);
+}
+
+static const GimpImageType CHANNEL_IMAGE_TYPES[] = {GIMP_GRAY_IMAGE, GIMP_GRAYA_IMAGE, GIMP_RGB_IMAGE, GIMP_RGBA_IMAGE};
+
+static VkFormat data_vk_format(VkFormat vk_format) {
+  switch (vk_format) {
+  case VK_FORMAT_R8_SRGB:
+    return VK_FORMAT_R8_UNORM;
+  case VK_FORMAT_R8G8_SRGB:
+    return VK_FORMAT_R8G8_UNORM;
+  case VK_FORMAT_R8G8B8_SRGB:
+    return VK_FORMAT_R8G8B8_UNORM;
+  case VK_FORMAT_R8G8B8A8_SRGB:
+    return VK_FORMAT_R8G8B8A8_UNORM;
+  default:
+    return vk_format;
+  }
+}
+
+// rule is NULL when exporting a single drawable as it is
+static const char* prepare_export_job(gint32 image_ID, gint32 drawable_ID, const TextureSetRule* rule, export_job_t* job) {
+  GimpPrecision precision = gimp_image_get_precision(image_ID);
+  gint channels = rule ? rule->channels : 0;
+  GimpImageType image_type = channels ? CHANNEL_IMAGE_TYPES[channels - 1] : gimp_drawable_type(drawable_ID);
+  const char* error = choose_vk_format(image_type, precision, &job->vk_format);
+  if (error)
+    return error;
+  // Only the tag changes, the bytes are still read as painted (non linear) below
+  if (rule && rule->data)
+    job->vk_format = data_vk_format(job->vk_format);
+  // Linear precisions are the multiples of 100, the x50/x75 ones are non linear/perceptual
+  job->format =
+      channels ? texture_set_format(drawable_ID, channels, ((unsigned)precision % 100) == 0) : gimp_drawable_get_format(drawable_ID);
+  job->drawable = gimp_drawable_get_buffer(drawable_ID);
+  return NULL;
+}
+
+// All textures of a set have the canvas size, so the super compressed ones are the slowest
+static gint compare_export_job_cost(gconstpointer a, gconstpointer b) {
+  const export_job_t* job_a = *(const export_job_t* const*)a;
+  const export_job_t* job_b = *(const export_job_t* const*)b;
+  return (job_a->super_compression < job_b->super_compression) - (job_a->super_compression > job_b->super_compression);
+}
+
+// GIMP only asks about overwriting the chosen filename, which texture sets do not write
+static gboolean confirm_overwrite(GPtrArray* jobs) {
+  GString* existing = g_string_new(NULL);
+  for (guint job_i = 0; job_i < jobs->len; job_i++) {
+    export_job_t* job = g_ptr_array_index(jobs, job_i);
+    if (g_file_test(job->filename, G_FILE_TEST_EXISTS))
+      g_string_append_printf(existing, "%s%s", existing->len ? "\n" : "", job->filename);
+  }
+  gboolean result = TRUE;
+  if (existing->len) {
+    GtkWidget* dialog = gtk_message_dialog_new(
+        NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_QUESTION, GTK_BUTTONS_OK_CANCEL, "Overwrite existing texture set files?");
+    gtk_message_dialog_format_secondary_text(GTK_MESSAGE_DIALOG(dialog), "%s", existing->str);
+    result = gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_OK;
+    gtk_widget_destroy(dialog);
+  }
+  g_string_free(existing, TRUE);
+  return result;
+}
+
+// filename itself is not written. targets lists the files the set was written to (if any were queued).
+// Interactive runs ask before overwriting existing files and set cancelled if the user declines.
+static const char* save_texture_set(gint32 image_ID,
+    const gchar* filename,
+    const SaveOptions* save_options,
+    GimpRunMode run_mode,
+    gchar** targets,
+    gboolean* cancelled) {
+  gint n_layers;
+  gint* layer_IDs = gimp_image_get_layers(image_ID, &n_layers);
+  GPtrArray* jobs = g_ptr_array_new();
+  GHashTable* used_suffixes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  GeglRectangle canvas = {.x = 0, .y = 0, .width = gimp_image_width(image_ID), .height = gimp_image_height(image_ID)};
+  const char* error = NULL;
+  for (gint layer_i = 0; (layer_i < n_layers) && !error; layer_i++) {
+    if (!gimp_item_get_visible(layer_IDs[layer_i]))
+      continue;
+    gchar* layer_name = gimp_item_get_name(layer_IDs[layer_i]);
+    TextureSetRule rule = texture_set_rule(layer_name);
+    export_job_t* job = g_new0(export_job_t, 1);
+    error = prepare_export_job(image_ID, layer_IDs[layer_i], &rule, job);
+    if (error) {
+      g_free(job);
+      g_free(layer_name);
+      break;
+    }
+    // Drawable buffers fetch their tiles over the plug-in wire, which must only be used from this thread.
+    // The local copy is canvas sized with the layer at its offset (zero outside), so all textures of a set match.
+    GeglBuffer* drawable = job->drawable;
+    job->drawable = gegl_buffer_new(&canvas, gegl_buffer_get_format(drawable));
+    gint offset_x, offset_y;
+    gimp_drawable_offsets(layer_IDs[layer_i], &offset_x, &offset_y);
+    GeglRectangle layer_rect = {
+        .x = offset_x, .y = offset_y, .width = gegl_buffer_get_width(drawable), .height = gegl_buffer_get_height(drawable)};
+    GeglRectangle visible_rect;
+    if (gegl_rectangle_intersect(&visible_rect, &layer_rect, &canvas)) {
+      GeglRectangle source_rect = {
+          .x = visible_rect.x - offset_x, .y = visible_rect.y - offset_y, .width = visible_rect.width, .height = visible_rect.height};
+      gegl_buffer_copy(drawable, &source_rect, GEGL_ABYSS_NONE, job->drawable, &visible_rect);
+    }
+    g_object_unref(drawable);
+    job->super_compression = rule.compress ? save_options->super_compression : 0;
+    job->filename = texture_set_filename(filename, layer_name, layer_i, used_suffixes);
+    g_free(layer_name);
+    g_ptr_array_add(jobs, job);
+  }
+  g_free(layer_IDs);
+  g_hash_table_destroy(used_suffixes);
+  if (!error && (jobs->len == 0))
+    error = "No visible layers to export";
+
+  *cancelled = !error && (run_mode == GIMP_RUN_INTERACTIVE) && !confirm_overwrite(jobs);
+
+  GString* target_list = g_string_new(NULL);
+  if (!error && !*cancelled) {
+    for (guint job_i = 0; job_i < jobs->len; job_i++)
+      g_string_append_printf(target_list, "%s%s", job_i ? ", " : "", ((export_job_t*)g_ptr_array_index(jobs, job_i))->filename);
+    // Slowest textures first, so the set takes about as long as its slowest texture
+    g_ptr_array_sort(jobs, compare_export_job_cost);
+    GThreadPool* pool = g_thread_pool_new(export_texture_worker, NULL, g_get_num_processors(), FALSE, NULL);
+    for (guint job_i = 0; job_i < jobs->len; job_i++)
+      g_thread_pool_push(pool, g_ptr_array_index(jobs, job_i), NULL);
+    g_thread_pool_free(pool, FALSE, TRUE);
+  }
+
+  for (guint job_i = 0; job_i < jobs->len; job_i++) {
+    export_job_t* job = g_ptr_array_index(jobs, job_i);
+    if (!error && job->error) {
+      gchar* message = g_strdup_printf("%s: %s", job->filename, job->error);
+      error = g_intern_string(message);
+      g_free(message);
+    }
+    g_object_unref(job->drawable);
+    g_free(job->filename);
+    g_free(job);
+  }
+  g_ptr_array_free(jobs, TRUE);
+  *targets = g_string_free(target_list, FALSE);
+  return error;
+}
+
+static void save(gint nparams, const GimpParam* param, gint* nreturn_vals, GimpParam** return_vals) {
+  GimpParam* ret_values = g_new(GimpParam, 2);
+  *nreturn_vals = 2;
+  *return_vals = ret_values;
+  {
+    ret_values[0].type = GIMP_PDB_STATUS;
+    ret_values[0].data.d_status = GIMP_PDB_EXECUTION_ERROR;
+    ret_values[1].type = GIMP_PDB_STRING;
+    ret_values[1].data.d_string = "Error while saveing";
+  }
+  GimpRunMode run_mode = (GimpRunMode)param[0].data.d_int32;
+  gint32 image_ID = param[1].data.d_int32;
+  gint32 drawable_ID = param[2].data.d_int32;
+  gchar* filename = param[3].data.d_string;
+  gimp_ui_init(PLUG_IN_BINARY, FALSE);
+
+  // Options come first, as texture sets need the layers to survive gimp_export_image
   SaveOptions save_options = DEFAULT_SAVE_OPTIONS;
   switch (run_mode) {
   case GIMP_RUN_INTERACTIVE:
@@ -533,8 +873,10 @@ static void save(gint nparams, const GimpParam* param, gint* nreturn_vals, GimpP
     break;
 
   case GIMP_RUN_NONINTERACTIVE:
-    if (nparams == 6) {
+    if ((nparams == 6) || (nparams == 7)) {
       save_options.super_compression = param[5].data.d_int32;
+      if (nparams == 7)
+        save_options.texture_set = param[6].data.d_int32;
 
       if ((save_options.super_compression < 0) || (save_options.super_compression > 255)) {
         ret_values[0].data.d_status = GIMP_PDB_CALLING_ERROR;
@@ -551,48 +893,47 @@ static void save(gint nparams, const GimpParam* param, gint* nreturn_vals, GimpP
     break;
   }
 
-  GeglBuffer* drawable = gimp_drawable_get_buffer(drawable_ID);
-  create_info.baseWidth = gegl_buffer_get_width(drawable);
-  create_info.baseHeight = gegl_buffer_get_height(drawable);
-  create_info.baseDepth = 1;
-  create_info.numDimensions = 2;
-  GLuint max_dim = create_info.baseWidth > create_info.baseHeight ? create_info.baseWidth : create_info.baseHeight;
-  create_info.numLevels = log2(max_dim) + 1;
-  // create_info.numLevels = 1; // TODO: Setting
-  create_info.numLayers = 1;
-  create_info.numFaces = 1;
-  create_info.isArray = KTX_FALSE;
-  create_info.generateMipmaps = KTX_FALSE;
-  ktxTexture2* texture;
-  KTX_error_code result = ktxTexture2_Create(&create_info, KTX_TEXTURE_CREATE_ALLOC_STORAGE, &texture);
-  if (result != KTX_SUCCESS) {
-    ret_values[1].data.d_string = (char*)ktxErrorString(result);
-    g_object_unref(drawable);
-    return;
-  }
-  mip_map_userdata_t mip_map_userdata;
-  mip_map_userdata.drawable_ID = drawable_ID;
-  mip_map_userdata.drawable = drawable;
-  mip_map_userdata.texture = texture;
-  mip_map_userdata.format = format;
-  result = ktxTexture_IterateLevelFaces(ktxTexture(texture), &mipmap_export, &mip_map_userdata);
-  if (result != KTX_SUCCESS) {
-    ret_values[1].data.d_string = (char*)ktxErrorString(result);
-    ktxTexture_Destroy(ktxTexture(texture));
-    g_object_unref(drawable);
+  GimpExportCapabilities capabilities = GIMP_EXPORT_CAN_HANDLE_RGB | GIMP_EXPORT_CAN_HANDLE_GRAY | GIMP_EXPORT_CAN_HANDLE_ALPHA;
+  if (save_options.texture_set)
+    capabilities |= GIMP_EXPORT_CAN_HANDLE_LAYERS;
+  GimpExportReturn export_return = gimp_export_image(&image_ID, &drawable_ID, "KTX2", capabilities);
+  if (export_return == GIMP_EXPORT_CANCEL) {
+    ret_values[0].data.d_status = GIMP_PDB_CANCEL;
     return;
   }
-  g_object_unref(drawable);
-  if (save_options.super_compression) {
-    result = ktxTexture2_CompressBasis(texture, save_options.super_compression);
-    if (result != KTX_SUCCESS) {
-      ret_values[1].data.d_string = (char*)ktxErrorString(result);
-      ktxTexture_Destroy(ktxTexture(texture));
+
+  const char* error;
+  if (save_options.texture_set) {
+    gchar* targets;
+    gboolean cancelled;
+    error = save_texture_set(image_ID, filename, &save_options, run_mode, &targets, &cancelled);
+    if (cancelled) {
+      g_free(targets);
+      ret_values[0].data.d_status = GIMP_PDB_CANCEL;
       return;
     }
+    // The sibling files were never shown in the save dialog, so tell scripted callers what was to be written
+    if (error && *targets && (run_mode == GIMP_RUN_NONINTERACTIVE)) {
+      gchar* message = g_strdup_printf("%s (texture set: %s)", error, targets);
+      error = g_intern_string(message);
+      g_free(message);
+    }
+    g_free(targets);
+  } else {
+    export_job_t job = {0};
+    error = prepare_export_job(image_ID, drawable_ID, NULL, &job);
+    if (!error) {
+      job.super_compression = save_options.super_compression;
+      job.filename = filename;
+      export_texture(&job);
+      error = job.error;
+      g_object_unref(job.drawable);
+    }
+  }
+  if (error) {
+    ret_values[1].data.d_string = (char*)error;
+    return;
   }
-  ktxTexture_WriteToNamedFile(ktxTexture(texture), filename);
-  ktxTexture_Destroy(ktxTexture(texture));
   *nreturn_vals = 1;
   ret_values[0].data.d_status = GIMP_PDB_SUCCESS;
 }
@@ -620,7 +961,8 @@ static void query() {
       {GIMP_PDB_DRAWABLE, "drawable", "Drawable to save"},
       {GIMP_PDB_STRING, "filename", "The name of the file to save the image in"},
       {GIMP_PDB_STRING, "raw-filename", "The name entered"},
-      {GIMP_PDB_INT32, "super-compression", "?"}};
+      {GIMP_PDB_INT32, "super-compression", "?"},
+      {GIMP_PDB_INT32, "texture-set", "Save every visible layer to its own <filename>_<layer>.ktx2 (TRUE or FALSE)"}};
 
   gimp_install_procedure(LOAD_PROC,
       "Loads KTX/KTX2 images",